@@ -29,6 +29,8 @@
 #define DSLINK_BUGFIX_VERSION 0
 
 #define OPEN_POLL_INTERVAL 200
+#define CAPTURE_REDRAW_INTERVAL 50
+#define CAPTURE_MAX_DRAIN 64 // max reports read per poll tick while capturing
 
 #define DUALSENSE_VID 0x054C
 #define DUALSENSE_PID 0x0CE6
@@ -97,6 +99,11 @@
 
 #define CRC32_POLYNOMIAL 0xEDB88320
 
+#define OFFSET_GYRO 16
+#define OFFSET_ACCEL 22
+#define OFFSET_SENSOR_TIMESTAMP 27 // uint32, little endian, 1/3 microsecond units
+#define SENSOR_TICKS_PER_MS 3000.0
+
 typedef enum {
     BATTERY_UNKNOWN,
     BATTERY_DISCHARGING,
@@ -106,6 +113,32 @@ typedef enum {
     BATTERY_TEMP_LOW
 } battery_status_t;
 
+typedef enum {
+    CAPTURE_OFF,
+    CAPTURE_RING,
+    CAPTURE_ONCE
+} capture_mode_t;
+
+typedef enum {
+    CAPTURE_TIME,
+    CAPTURE_GYRO_X, CAPTURE_GYRO_Y, CAPTURE_GYRO_Z,
+    CAPTURE_ACCEL_X, CAPTURE_ACCEL_Y, CAPTURE_ACCEL_Z,
+    CAPTURE_ANALOG_L_X, CAPTURE_ANALOG_L_Y,
+    CAPTURE_ANALOG_R_X, CAPTURE_ANALOG_R_Y,
+    CAPTURE_TRIGGER_L, CAPTURE_TRIGGER_R,
+    CAPTURE_FIELD_COUNT
+} capture_field_t;
+
+// names as used by the 'array' message, axis is NULL for single value sources
+static const struct { const char *source, *axis; } capture_names[CAPTURE_FIELD_COUNT] = {
+    { "time", NULL },
+    { "gyro", "x" }, { "gyro", "y" }, { "gyro", "z" },
+    { "accel", "x" }, { "accel", "y" }, { "accel", "z" },
+    { "analog", "lx" }, { "analog", "ly" },
+    { "analog", "rx" }, { "analog", "ry" },
+    { "trigger", "l" }, { "trigger", "r" }
+};
+
 typedef struct {
     struct {
         struct { t_float x, y; } l, r;
@@ -144,7 +177,18 @@ typedef struct _dslink {
     t_clock *poll_clock;
     t_clock *open_clock;
     t_clock *write_clock; // clock for write scheduling
+    t_clock *redraw_clock; // throttled redraw of capture arrays
     t_float poll_interval;
+    t_float redraw_interval;
+
+    // capture of incoming reports into garrays
+    t_symbol *capture_arrays[CAPTURE_FIELD_COUNT];
+    capture_mode_t capture_mode;
+    int capture_index;
+    int capture_dirty;
+    int capture_started; // set after first captured report to initialize timestamp
+    uint32_t capture_timestamp; // last raw sensor timestamp
+    double capture_time; // ms since capture start
 
     t_dslink_state state;
 } t_dslink;
@@ -160,6 +204,8 @@ static uint32_t crc32(const uint8_t *data, size_t len);
 static void parse_input_report(t_dslink *x, const unsigned char *buf, int filter);
 static void output_value(t_outlet *outlet, const char *parts[], int num_parts, t_float *state_value, t_float value, int filter);
 static void do_write(t_dslink *x);
+static void capture_drain(t_dslink *x, int res);
+static void capture_stop(t_dslink *x);
 static int do_open(t_dslink *x);
 static void poll_tick(t_dslink *x);
 
@@ -183,6 +229,8 @@ static inline int dslink_read(t_dslink *x) {
         output_value(x->status_out, (const char*[]){"connected"}, 1, &x->state.connected, 0, 0);
         return 0;
     }
+    // while capturing, read all pending reports instead of just one per tick
+    if (x->capture_mode != CAPTURE_OFF && res > 0) capture_drain(x, res);
     parse_input_report(x, x->read_buf, 1);
 
     if (x->poll_interval > 0) {
@@ -311,9 +359,53 @@ static void dslink_reconnect(t_dslink *x) {
     clock_delay(x->open_clock, 0);
 }
 
+// array <source> [<axis>] [<name>] - bind (or unbind without name) a capture array
+static void dslink_array(t_dslink *x, t_symbol *s, int argc, t_atom *argv) {
+    (void)s;
+
+    t_symbol *source = atom_getsymbolarg(0, argc, argv);
+    t_symbol *axis = atom_getsymbolarg(1, argc, argv);
+
+    for (int i = 0; i < CAPTURE_FIELD_COUNT; i++) {
+        if (source != gensym(capture_names[i].source)) continue;
+        int name_index = 1;
+        if (capture_names[i].axis) {
+            if (axis != gensym(capture_names[i].axis)) continue;
+            name_index = 2;
+        }
+        t_symbol *name = atom_getsymbolarg(name_index, argc, argv);
+        x->capture_arrays[i] = (name == &s_) ? NULL : name;
+        return;
+    }
+    pd_error(x, "dslink: array: unknown source '%s %s'", source->s_name, axis->s_name);
+}
+
+// capture ring|once|stop
+static void dslink_capture(t_dslink *x, t_symbol *mode) {
+    if (mode == gensym("ring") || mode == gensym("once")) {
+        x->capture_mode = (mode == gensym("ring")) ? CAPTURE_RING : CAPTURE_ONCE;
+        x->capture_index = 0;
+        x->capture_started = 0;
+        x->capture_time = 0;
+    } else if (mode == gensym("stop") || mode == &s_) {
+        capture_stop(x);
+    } else
+        pd_error(x, "dslink: capture: unknown mode '%s'", mode->s_name);
+}
+
+static void dslink_redraw(t_dslink *x, t_floatarg f) {
+    x->redraw_interval = f > 0 ? f : 0;
+}
+
 
 // Utility functions
 
+// signed 16 bit sensor value, scaled to roughly 1 for earth gravity
+static inline t_float imu_axis(const unsigned char *buf, int index) {
+    uint16_t raw = (uint16_t)((buf[index + 1]) | buf[index] << 8);
+    return (t_float)((raw > 32767) ? raw - 65536 : raw) / 8192.0f;
+}
+
 // perform actual HID write, called by clock
 static void do_write(t_dslink *x) {
     if (!x->handle || x->write_size == 0) {
@@ -407,6 +499,128 @@ static void open_tick(t_dslink *x)
         clock_delay(x->open_clock, OPEN_POLL_INTERVAL);
 }
 
+static void output_capture(t_dslink *x, const char *type) {
+    t_atom atoms[2];
+    SETSYMBOL(&atoms[0], gensym(type));
+    SETFLOAT(&atoms[1], x->capture_index);
+    outlet_anything(x->status_out, gensym("capture"), 2, atoms);
+}
+
+// redraw bound arrays at most once per redraw interval
+static void redraw_tick(t_dslink *x) {
+    if (!x->capture_dirty) return;
+    x->capture_dirty = 0;
+
+    for (int i = 0; i < CAPTURE_FIELD_COUNT; i++) {
+        if (!x->capture_arrays[i]) continue;
+        t_garray *a = (t_garray *)pd_findbyclass(x->capture_arrays[i], garray_class);
+        if (a) garray_redraw(a);
+    }
+    if (x->capture_mode != CAPTURE_OFF) output_capture(x, "index");
+}
+
+static void capture_stop(t_dslink *x) {
+    x->capture_mode = CAPTURE_OFF;
+    if (x->capture_dirty) {
+        clock_unset(x->redraw_clock);
+        redraw_tick(x);
+    }
+}
+
+// look up all bound arrays, returns smallest array size or 0 on failure
+static int capture_resolve(t_dslink *x, t_word *vecs[]) {
+    int size = -1;
+
+    for (int i = 0; i < CAPTURE_FIELD_COUNT; i++) {
+        vecs[i] = NULL;
+        if (!x->capture_arrays[i]) continue;
+
+        const char *name = x->capture_arrays[i]->s_name;
+        t_garray *a = (t_garray *)pd_findbyclass(x->capture_arrays[i], garray_class);
+        int n;
+        if (!a) {
+            pd_error(x, "dslink: %s: no such array", name);
+            return 0;
+        }
+        if (!garray_getfloatwords(a, &n, &vecs[i])) {
+            pd_error(x, "dslink: %s: bad template for capture", name);
+            return 0;
+        }
+        if (size < 0 || n < size) size = n;
+    }
+    if (size < 0) pd_error(x, "dslink: no arrays set for capture");
+    return size > 0 ? size : 0;
+}
+
+// write one report into the capture arrays, returns 0 when a one-shot capture is complete
+static int capture_report(t_dslink *x, const unsigned char *buf, t_word *vecs[], int size) {
+    int offset = x->is_bluetooth ? 2 : 1;
+    t_float values[CAPTURE_FIELD_COUNT];
+
+    uint32_t timestamp = (uint32_t)buf[offset + OFFSET_SENSOR_TIMESTAMP]
+        | (uint32_t)buf[offset + OFFSET_SENSOR_TIMESTAMP + 1] << 8
+        | (uint32_t)buf[offset + OFFSET_SENSOR_TIMESTAMP + 2] << 16
+        | (uint32_t)buf[offset + OFFSET_SENSOR_TIMESTAMP + 3] << 24;
+    // unsigned difference handles counter wraparound
+    if (x->capture_started)
+        x->capture_time += (uint32_t)(timestamp - x->capture_timestamp) / SENSOR_TICKS_PER_MS;
+    x->capture_timestamp = timestamp;
+    x->capture_started = 1;
+
+    values[CAPTURE_TIME] = (t_float)x->capture_time;
+    for (int i = 0; i < 3; i++) {
+        values[CAPTURE_GYRO_X + i] = imu_axis(buf, offset + OFFSET_GYRO + i * 2);
+        values[CAPTURE_ACCEL_X + i] = imu_axis(buf, offset + OFFSET_ACCEL + i * 2);
+    }
+    values[CAPTURE_ANALOG_L_X] = (buf[offset + 0] - 128) / 128.0f;
+    values[CAPTURE_ANALOG_L_Y] = (buf[offset + 1] - 128) / -128.0f;
+    values[CAPTURE_ANALOG_R_X] = (buf[offset + 2] - 128) / 128.0f;
+    values[CAPTURE_ANALOG_R_Y] = (buf[offset + 3] - 128) / -128.0f;
+    values[CAPTURE_TRIGGER_L] = buf[offset + 4] / 255.0f;
+    values[CAPTURE_TRIGGER_R] = buf[offset + 5] / 255.0f;
+
+    if (x->capture_index >= size) x->capture_index = 0; // arrays might have been resized
+    for (int i = 0; i < CAPTURE_FIELD_COUNT; i++) {
+        if (vecs[i]) vecs[i][x->capture_index].w_float = values[i];
+    }
+    x->capture_index++;
+
+    if (x->capture_index >= size) {
+        if (x->capture_mode == CAPTURE_ONCE) return 0;
+        x->capture_index = 0;
+    }
+    return 1;
+}
+
+// write the report in read_buf and all further pending reports into the capture arrays
+static void capture_drain(t_dslink *x, int res) {
+    t_word *vecs[CAPTURE_FIELD_COUNT];
+    int size = capture_resolve(x, vecs);
+    if (!size) {
+        capture_stop(x);
+        return;
+    }
+
+    int count = 0;
+    int running = 1;
+    do {
+        // short bluetooth reports don't contain sensor data
+        if (res == INPUT_REPORT_BT_SHORT_SIZE) continue;
+        running = capture_report(x, x->read_buf, vecs, size);
+        count++;
+    } while (running && count < CAPTURE_MAX_DRAIN
+        && (res = hid_read(x->handle, x->read_buf, INPUT_REPORT_BT_SIZE)) > 0);
+
+    if (count && !x->capture_dirty) {
+        x->capture_dirty = 1;
+        clock_delay(x->redraw_clock, x->redraw_interval);
+    }
+    if (!running) {
+        capture_stop(x);
+        output_capture(x, "done");
+    }
+}
+
 static void output_value(t_outlet *outlet, const char *parts[], int num_parts, t_float *state_value, t_float value, int filter) {
     if (*state_value != value || !filter) {
         *state_value = value;
@@ -486,13 +700,9 @@ static inline void parse_input_report(t_dslink *x, const unsigned char *buf, int
     output_value(x->data_out, (const char*[]){"digital", "y"}, 2, &x->state.digital.y, digital_y, filter);
 
     // Gyroscope
-    uint16_t gyro_x_raw = (uint16_t)((buf[offset + 17]) | buf[offset + 16] << 8);
-    uint16_t gyro_y_raw = (uint16_t)((buf[offset + 19]) | buf[offset + 18] << 8);
-    uint16_t gyro_z_raw = (uint16_t)((buf[offset + 21]) | buf[offset + 20] << 8);
-
-    t_float gyro_x = (t_float)((gyro_x_raw > 32767) ? gyro_x_raw - 65536 : gyro_x_raw) / 8192.0f;
-    t_float gyro_y = (t_float)((gyro_y_raw > 32767) ? gyro_y_raw - 65536 : gyro_y_raw) / 8192.0f;
-    t_float gyro_z = (t_float)((gyro_z_raw > 32767) ? gyro_z_raw - 65536 : gyro_z_raw) / 8192.0f;
+    t_float gyro_x = imu_axis(buf, offset + OFFSET_GYRO);
+    t_float gyro_y = imu_axis(buf, offset + OFFSET_GYRO + 2);
+    t_float gyro_z = imu_axis(buf, offset + OFFSET_GYRO + 4);
 
     t_atom gyro_list[3];
     SETFLOAT(gyro_list    , gyro_x);
@@ -501,13 +711,9 @@ static inline void parse_input_report(t_dslink *x, const unsigned char *buf, int
     outlet_anything(x->imu_out, gensym("gyro"), 3, gyro_list);
 
     // Accelerometer
-    uint16_t accel_x_raw = (uint16_t)((buf[offset + 23]) | buf[offset + 22] << 8);
-    uint16_t accel_y_raw = (uint16_t)((buf[offset + 25]) | buf[offset + 24] << 8);
-    uint16_t accel_z_raw = (uint16_t)((buf[offset + 27]) | buf[offset + 26] << 8);
-
-    t_float accel_x = (t_float)((accel_x_raw > 32767) ? accel_x_raw - 65536 : accel_x_raw) / 8192.0f;
-    t_float accel_y = (t_float)((accel_y_raw > 32767) ? accel_y_raw - 65536 : accel_y_raw) / 8192.0f;
-    t_float accel_z = (t_float)((accel_z_raw > 32767) ? accel_z_raw - 65536 : accel_z_raw) / 8192.0f;
+    t_float accel_x = imu_axis(buf, offset + OFFSET_ACCEL);
+    t_float accel_y = imu_axis(buf, offset + OFFSET_ACCEL + 2);
+    t_float accel_z = imu_axis(buf, offset + OFFSET_ACCEL + 4);
 
     t_atom accel_list[3];
     SETFLOAT(accel_list    , accel_x);
@@ -581,6 +787,7 @@ static void dslink_free(t_dslink *x) {
     clock_unset(x->poll_clock);
     clock_unset(x->write_clock);
     clock_unset(x->open_clock);
+    clock_unset(x->redraw_clock);
 
     if (x->poll_clock) {
         clock_free(x->poll_clock);
@@ -594,6 +801,10 @@ static void dslink_free(t_dslink *x) {
         clock_free(x->open_clock);
         x->open_clock = NULL;
     }
+    if (x->redraw_clock) {
+        clock_free(x->redraw_clock);
+        x->redraw_clock = NULL;
+    }
 
     hid_exit();
 }
@@ -609,9 +820,17 @@ static void *dslink_new(t_floatarg f) {
     x->poll_clock = clock_new(x, (t_method)poll_tick);
     x->write_clock = clock_new(x, (t_method)do_write);
     x->open_clock = clock_new(x, (t_method)open_tick);
+    x->redraw_clock = clock_new(x, (t_method)redraw_tick);
     x->poll_interval = 0;
+    x->redraw_interval = CAPTURE_REDRAW_INTERVAL;
     x->handle = NULL;
 
+    memset(x->capture_arrays, 0, sizeof(x->capture_arrays));
+    x->capture_mode = CAPTURE_OFF;
+    x->capture_index = 0;
+    x->capture_dirty = 0;
+    x->capture_started = 0;
+
     memset(&x->state, 0, sizeof(t_dslink_state));
     
     if (f != -1) {
@@ -649,6 +868,9 @@ void dslink_setup(void) {
     class_addmethod(dslink_class, (t_method)dslink_configure, gensym("configure"), A_FLOAT, 0);
     class_addmethod(dslink_class, (t_method)dslink_set_led, gensym("led"), A_GIMME, 0);
     class_addmethod(dslink_class, (t_method)dslink_set_trigger, gensym("trigger"), A_GIMME, 0);
+    class_addmethod(dslink_class, (t_method)dslink_array, gensym("array"), A_GIMME, 0);
+    class_addmethod(dslink_class, (t_method)dslink_capture, gensym("capture"), A_DEFSYMBOL, 0);
+    class_addmethod(dslink_class, (t_method)dslink_redraw, gensym("redraw"), A_FLOAT, 0);
 
     post("\n  dslink v%d.%d.%d", DSLINK_MAJOR_VERSION, DSLINK_MINOR_VERSION, DSLINK_BUGFIX_VERSION);
     post(  "  hidapi v%d.%d.%d\n", HID_API_VERSION_MAJOR, HID_API_VERSION_MINOR, HID_API_VERSION_PATCH);